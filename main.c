@@ -16,19 +16,14 @@ int main(int argc, char *argv[]) {
     for(iowon=0; iowon < numowondevices; iowon++){
       if (!openCommunication(owon_devices[iowon])){ 
         owonReadMemory(owon_devices[iowon]);
-        printFileInfo(oinfo);
+        printFileInfo(&oinfo);
         for (i=0; i<oinfo.nchannels; i++)
-          printChannelInfo(oinfo.channels[i]);
+          printChannelInfo(&oinfo.channels[i]);
         sprintf(fn, "psowon%d.asc", iowon);
         saveDataASCII(fn);
         sprintf(fn, "psowon%d.m", iowon);
         saveDataMatlab(fn);
-        if (debug) printf("Freeing memory:\n");
-        for (i=oinfo.nchannels-1; i>=0; i--){
-          if (debug) printf("--block %d, size %d bytes at %p.\n", i,
-                oinfo.channels[i].memorysize, oinfo.channels[i].memoryaddress);
-          free(oinfo.channels[i].memoryaddress);		
-        }
+        freeOwonData(&oinfo);
         closeCommunication();
       }
     }
@@ -0,0 +1,255 @@
+/**************************************************************\
+ * PSOwon. Benchmark of parsing, converting and saving data   *
+ *    Peter Stallinga, 2020.                                  *
+ *                                                            *
+ * Generates synthetic SPB vectorgrams (no scope needed) and  *
+ * times every stage. Compile with -Ddebug=0.                 *
+\**************************************************************/
+
+#include <math.h>
+#include "owonlib.h"
+
+#define FILE_HEADER_LENGTH 54         // as sent by an SDS7102
+#define CHANNEL_HEADER_LENGTH 59      // "CHx" + 14 ints
+#define MIN_SECONDS 0.2               // repeat a stage at least this long
+#define ASC_FILE "owonbench.asc"
+#define MATLAB_FILE "owonbench.m"
+
+struct benchResult {
+  char stage[16];
+  int nchannels;
+  int npoints;        // per channel
+  long bytes;         // size of the vectorgram
+  int repeats;
+  double seconds;     // per repeat
+  int persample;      // time grows with the samples (parse only reads headers)
+};
+
+struct benchResult results[256];
+int nresults = 0;
+
+// synthetic capture, one block per channel as read from the scope:
+char *blocks[MAX_CHANNELS];
+int blocksizes[MAX_CHANNELS];
+double *volts;        // output of the convert stage
+double measurement;   // keeps the compiler from dropping the work
+
+double now(){
+  struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return(t.tv_sec + t.tv_nsec*1e-9);
+}
+
+void putInt(char **p, int v){
+  memcpy(*p, &v, 4);
+  *p += 4;
+}
+
+// Build a capture the way the scope sends it: the first block starts with
+// the file header, every block has a channel header followed by the samples.
+void makeVectorgram(int nchannels, int npoints){
+  int ichan, j;
+  char *p;
+  short int s;
+
+  for (ichan=0; ichan<nchannels; ichan++){
+    blocksizes[ichan] = (ichan==0 ? FILE_HEADER_LENGTH : 0) + CHANNEL_HEADER_LENGTH + 2*npoints;
+    blocks[ichan] = malloc(blocksizes[ichan]);
+    if (!blocks[ichan]) {
+      printf("ERROR: Failed to malloc(0x%08xh)!\n", blocksizes[ichan]);
+      exit(1);
+    }
+    memset(blocks[ichan], 0, blocksizes[ichan]);
+    p = blocks[ichan];
+    if (ichan==0) {
+      memcpy(p, "SPBS02", 6);
+      memcpy(p+19, "SDS7102", 7);
+      p += FILE_HEADER_LENGTH;
+    }
+    *p++ = 'C';
+    *p++ = 'H';
+    *p++ = (ichan<9) ? '1'+ichan : 'A'+ichan-9;
+    putInt(&p, CHANNEL_HEADER_LENGTH-3+2*npoints);  // blocklength
+    putInt(&p, 0);              // extendedflag
+    putInt(&p, 0);              // offset
+    putInt(&p, npoints);        // wholescreencollectingpoints
+    putInt(&p, npoints);        // numberofcollectingpoints
+    putInt(&p, 0);              // slowmovingnumber
+    putInt(&p, 16);             // timebaselevel: 1 ms/div
+    putInt(&p, 0);              // zeropoint
+    putInt(&p, 8-ichan%4);      // voltagelevel
+    putInt(&p, 0);              // attenmultpowrindex
+    putInt(&p, 0);              // spacinginterval
+    putInt(&p, 1000);           // frequency
+    putInt(&p, 1000);           // cycle
+    putInt(&p, 0);              // voltvalueperpoint
+    for (j=0; j<npoints; j++){
+      s = (short int) (100.0*sin(2*M_PI*j*(ichan+1)/500.0)) + (j*7919)%5-2;
+      memcpy(p, &s, 2);
+      p += 2;
+    }
+  }
+}
+
+void freeVectorgram(int nchannels){
+  int ichan;
+
+  for (ichan=0; ichan<nchannels; ichan++){
+    free(blocks[ichan]);
+    blocks[ichan] = NULL;
+  }
+}
+
+// the stages; oinfo refers to the synthetic blocks, which are not its to free
+void stageParse(int nchannels){
+  int ichan;
+
+  oinfo.nchannels = 0;
+  for (ichan=0; ichan<nchannels; ichan++)
+    decodeOwonBuffer(blocks[ichan], blocksizes[ichan]);
+}
+
+void stageConvert(int nchannels){
+  int ichan, j, n;
+  double *v = volts;
+
+  for (ichan=0; ichan<oinfo.nchannels; ichan++){
+    n = owonSampleCount(&oinfo.channels[ichan]);
+    for (j=0; j<n; j++)
+      *v++ = owonSampleVolt(&oinfo.channels[ichan], j);
+  }
+}
+
+// peak-to-peak, mean and rms of every channel
+void stageMeasure(int nchannels){
+  int ichan, j, n;
+  double v, vmin, vmax, sum, sum2;
+
+  measurement = 0;
+  for (ichan=0; ichan<oinfo.nchannels; ichan++){
+    n = owonSampleCount(&oinfo.channels[ichan]);
+    vmin = 1e300;
+    vmax = -1e300;
+    sum = sum2 = 0;
+    for (j=0; j<n; j++){
+      v = owonSampleVolt(&oinfo.channels[ichan], j);
+      if (v<vmin) vmin=v;
+      if (v>vmax) vmax=v;
+      sum += v;
+      sum2 += v*v;
+    }
+    measurement += (vmax-vmin) + sum/n + sqrt(sum2/n);
+  }
+}
+
+void stageASCII(int nchannels){
+  saveDataASCII(ASC_FILE);
+}
+
+void stageMatlab(int nchannels){
+  saveDataMatlab(MATLAB_FILE);
+}
+
+void stageAll(int nchannels){
+  stageParse(nchannels);
+  stageConvert(nchannels);
+  stageMeasure(nchannels);
+  stageASCII(nchannels);
+  stageMatlab(nchannels);
+}
+
+void runStage(char *name, void (*stage)(int), int persample, int nchannels, int npoints){
+  struct benchResult *r;
+  double t0, t;
+  int ichan, n=0;
+
+  stageParse(nchannels);  // all stages but parse need a decoded capture
+  t0 = now();
+  do {
+    stage(nchannels);
+    n++;
+    t = now()-t0;
+  } while (t<MIN_SECONDS);
+
+  if (nresults>=(int) (sizeof(results)/sizeof(results[0]))) return;
+  r = &results[nresults++];
+  strncpy(r->stage, name, sizeof(r->stage)-1);
+  r->nchannels = nchannels;
+  r->npoints = npoints;
+  r->bytes = 0;
+  for (ichan=0; ichan<nchannels; ichan++) r->bytes += blocksizes[ichan];
+  r->repeats = n;
+  r->seconds = t/n;
+  r->persample = persample;
+  printf("%-8s %3d %9d %10ld %7d %12.3e %12.3e", r->stage, nchannels, npoints,
+      r->bytes, n, r->seconds, 1.0/r->seconds);
+  if (persample)
+    printf(" %12.3e %12.3e\n", nchannels*(double) npoints/r->seconds, r->bytes/r->seconds);
+  else
+    printf(" %12s %12s\n", "-", "-");
+}
+
+void saveResultsJSON(char *fname){
+  FILE *fout;
+  struct benchResult *r;
+  int i;
+
+  if ((fout=fopen(fname, "w")) == NULL) {
+    printf("ERROR: Failed to open file \'%s\'!\n", fname);
+    return;
+  }
+  fprintf(fout, "{\n  \"results\": [\n");
+  for (i=0; i<nresults; i++){
+    r = &results[i];
+    fprintf(fout, "    {\"stage\": \"%s\", \"channels\": %d, \"points\": %d, \"bytes\": %ld, "
+        "\"repeats\": %d, \"seconds\": %e, \"captures_per_sec\": %e, ",
+        r->stage, r->nchannels, r->npoints, r->bytes, r->repeats, r->seconds, 1.0/r->seconds);
+    if (r->persample)
+      fprintf(fout, "\"samples_per_sec\": %e, \"bytes_per_sec\": %e}",
+          r->nchannels*(double) r->npoints/r->seconds, r->bytes/r->seconds);
+    else  // parse only decodes the headers: a rate per sample means nothing
+      fprintf(fout, "\"samples_per_sec\": null, \"bytes_per_sec\": null}");
+    fprintf(fout, "%s\n", (i<nresults-1) ? "," : "");
+  }
+  fprintf(fout, "  ]\n}\n");
+  fclose(fout);
+  printf("\nResults written to \'%s\'\n", fname);
+}
+
+int main(int argc, char *argv[]) {
+  int channelcounts[] = { 1, 2, 4, MAX_CHANNELS };
+  int maxpoints = 300000;  // give 10000000 for deep memory
+  char *jsonfile = "owonbench.json";
+  int ic, npoints, nchannels;
+
+  if (argc>1) maxpoints = atoi(argv[1]);
+  if (argc>2) jsonfile = argv[2];
+  initializeOwonLib();
+
+  printf("stage    chn    points      bytes    reps    s/repeat   captures/s    samples/s      bytes/s\n");
+  for (npoints=3000; npoints<=maxpoints; npoints*=10){  // 3000 points = 6 kB per channel
+    volts = malloc(MAX_CHANNELS*sizeof(double)*npoints);
+    if (!volts) {
+      printf("ERROR: Failed to malloc(0x%08lxh)!\n", MAX_CHANNELS*sizeof(double)*npoints);
+      return 1;
+    }
+    for (ic=0; ic<(int) (sizeof(channelcounts)/sizeof(channelcounts[0])); ic++){
+      nchannels = channelcounts[ic];
+      makeVectorgram(nchannels, npoints);
+      runStage("parse", stageParse, 0, nchannels, npoints);
+      runStage("convert", stageConvert, 1, nchannels, npoints);
+      runStage("measure", stageMeasure, 1, nchannels, npoints);
+      runStage("ascii", stageASCII, 1, nchannels, npoints);
+      runStage("matlab", stageMatlab, 1, nchannels, npoints);
+      runStage("all", stageAll, 1, nchannels, npoints);
+      freeVectorgram(nchannels);
+    }
+    free(volts);
+    if (npoints>maxpoints/10 && npoints<maxpoints) npoints = maxpoints/10;  // end at maxpoints
+  }
+  remove(ASC_FILE);
+  remove(MATLAB_FILE);
+  saveResultsJSON(jsonfile);
+  return 0;
+}
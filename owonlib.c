@@ -15,8 +15,11 @@
 char *owondefaultfilename = "psowon.txt";
 char *owonfilename=NULL;
 struct owonInfo oinfo;
+struct owonFrame oframe;
 usb_dev_handle *devhandle;
 int numowondevices = 0;
+struct usb_device *owon_devices[MAX_OWON_DEVICES];
+int vgramheaderlength;
 
 // in case you need to convert:
 void litte2BigEndian(char *p){
@@ -29,67 +32,150 @@ void litte2BigEndian(char *p){
   *(p+2) = c;
 }
 
-void printFileInfo(struct owonInfo xinf){
+// time base (s/div) per timebaselevel, starting at level -2:
+static const double owonTimeBases[] = {
+  1.0E-9, 2.0E-9, 5.0E-9, 1.0E-8, 2.5E-8, 5.0E-8, 1.0E-7, 2.5E-7,
+  5.0E-7, 1.0E-6, 2.5E-6, 5.0E-6, 1.0E-5, 2.5E-5, 5.0E-5, 1.0E-4,
+  2.5E-4, 5.0E-4, 1.0E-3, 2.5E-3, 5.0E-3, 1.0E-2, 2.5E-2, 5.0E-2,
+  1.0E-1, 2.5E-1, 5.0E-1, 1.0, 2.5, 5.0, 10.0, 25.0, 50.0, 100.0 };
+
+// vertical scale (V/div) per voltagelevel, starting at level 0:
+static const double owonVoltScales[] = {
+  2E-3, 5E-3, 10E-3, 20E-3, 50E-3, 100E-3, 200E-3, 500E-3, 1.0, 2.0,
+  5.0, 10.0, 20.0, 50.0, 100.0, 200.0, 500.0, 1000.0, 2000.0, 5000.0, 1E4 };
+
+#define NELEM(a) ((int) (sizeof(a)/sizeof((a)[0])))
+#define SCALES(first, tab) { first, NELEM(tab), tab }
+
+// Model registry. Every scope family points to its own scale tables; the
+// Guidance Manual 1.3 gives one set for all of them, so they share it for now.
+// The SDS family has a long file header with the device name in it, at
+// offset 19; the older families only send the file description.
+// Adding a scope model means adding a row here.
+static const struct owonModel owonModels[] = {
+  // id       name        name in header  time base (s/div)            vertical scale (V/div)
+  { "SPBW01", "PDS6062x",  0, 0, SCALES(-2, owonTimeBases), SCALES(0, owonVoltScales) },
+  { "SPBW11", "HDS2062M",  0, 0, SCALES(-2, owonTimeBases), SCALES(0, owonVoltScales) },
+  { "SPBW10", "HDS2062N",  0, 0, SCALES(-2, owonTimeBases), SCALES(0, owonVoltScales) },
+  { "SPBV01", "PDS5022S",  0, 0, SCALES(-2, owonTimeBases), SCALES(0, owonVoltScales) },
+  { "SPBV10", "HDS1022N",  0, 0, SCALES(-2, owonTimeBases), SCALES(0, owonVoltScales) },
+  { "SPBV11", "HDS1022M",  0, 0, SCALES(-2, owonTimeBases), SCALES(0, owonVoltScales) },
+  { "SPBV12", "HDS1021M",  0, 0, SCALES(-2, owonTimeBases), SCALES(0, owonVoltScales) },
+  { "SPBX01", "MSO7102",   0, 0, SCALES(-2, owonTimeBases), SCALES(0, owonVoltScales) },
+  { "SPBX10", "HDS3102N",  0, 0, SCALES(-2, owonTimeBases), SCALES(0, owonVoltScales) },
+  { "SPBM01", "MSO8202",   0, 0, SCALES(-2, owonTimeBases), SCALES(0, owonVoltScales) },
+  { "SPBS01", "SDS6062",  19, 7, SCALES(-2, owonTimeBases), SCALES(0, owonVoltScales) },
+  { "SPBS02", "SDS7102",  19, 7, SCALES(-2, owonTimeBases), SCALES(0, owonVoltScales) },
+  { "SPBS03", "SDS8202",  19, 7, SCALES(-2, owonTimeBases), SCALES(0, owonVoltScales) },
+  { "SPBS04", "SDS9302",  19, 7, SCALES(-2, owonTimeBases), SCALES(0, owonVoltScales) },
+};
+
+// used for ids not in the registry; a long header is taken to be SDS-like:
+static const struct owonModel owonUnknownModel =
+  { "SPB???", "unknown",  19, 7, SCALES(-2, owonTimeBases), SCALES(0, owonVoltScales) };
+
+#define MODEL_HASH_SIZE 64            // power of 2, > 2x number of models
+static unsigned char owonModelHash[MODEL_HASH_SIZE];  // index+1 in owonModels, 0 = empty
+
+// hash on the last 3 characters of the id ("SPB" is common to all)
+static unsigned int modelHash(const char *id){
+  return ((unsigned char) id[3]*961u + (unsigned char) id[4]*31u + (unsigned char) id[5]) & (MODEL_HASH_SIZE-1);
+}
+
+static void buildModelHash(){
+  int i;
+  unsigned int h;
+
+  memset(owonModelHash, 0, sizeof(owonModelHash));
+  for (i=0; i<NELEM(owonModels); i++){
+    h = modelHash(owonModels[i].id);
+    while (owonModelHash[h]) h = (h+1) & (MODEL_HASH_SIZE-1);
+    owonModelHash[h] = i+1;
+  }
+}
+
+// The hash is built once by initializeOwonLib(), before any thread can read,
+// and is only read after that. Before it, the table is empty and every id
+// is unknown.
+const struct owonModel *findOwonModel(const char *id){
+  unsigned int h;
+
+  h = modelHash(id);
+  while (owonModelHash[h]) {
+    if (memcmp(owonModels[owonModelHash[h]-1].id, id, 6)==0)
+      return(&owonModels[owonModelHash[h]-1]);
+    h = (h+1) & (MODEL_HASH_SIZE-1);
+  }
+  return(&owonUnknownModel);
+}
+
+static double scaleValue(const struct owonScaleTable *t, int level){
+  level -= t->firstlevel;
+  if ((unsigned int) level < (unsigned int) t->nlevels) return(t->value[level]);
+  return(0.0);
+}
+
+void printFileInfo(const struct owonInfo *xinf){
   int chin;
-  printf("|-------------------- FILE DATA, %s (length:%4d) ------------------\n", xinf.idn, xinf.memorysize);
-  printf("| start address: %p\n", xinf.startaddress);
-  printf("| file description: %s\n", xinf.idn);
-  printf("| file length: %d bytes\n", xinf.memorysize);
-  printf("| device name: %s\n", xinf.devicename);
-  printf("| number of channels read: %d\n", oinfo.nchannels);
-  for (chin=0; chin<oinfo.nchannels; chin++)
-    printf("|   CH%d at address: %p\n", chin+1, xinf.channels[chin].headeraddress);	
+  printf("|-------------------- FILE DATA, %s (length:%4d) ------------------\n", xinf->idn, xinf->memorysize);
+  printf("| start address: %p\n", xinf->startaddress);
+  printf("| file description: %s\n", xinf->idn);
+  printf("| file length: %d bytes\n", xinf->memorysize);
+  printf("| device name: %s\n", xinf->devicename);
+  printf("| number of channels read: %d\n", xinf->nchannels);
+  for (chin=0; chin<xinf->nchannels; chin++)
+    printf("|   CH%d at address: %p\n", chin+1, xinf->channels[chin].headeraddress);	
   printf("|-----------------------------------------------------------------------\n\n");
 }
 
-void printChannelInfo(struct channelInfo chinfo){
-  printf("\n|-------------------- CHANNEL DATA, %s (length:%4d) ------------------\n", chinfo.channelname,chinfo.blocklength+3);
-  printf("| total memory size: %d bytes\n", chinfo.blocklength+3);
-  printf("| total memory size: %d bytes\n", chinfo.memorysize);
-  printf("| memory address: %p\n", chinfo.memoryaddress);
-  printf("| header address: %p\n", chinfo.headeraddress);
-  printf("| data address  : %p\n", chinfo.dataaddress);
+void printChannelInfo(const struct channelInfo *chinfo){
+  printf("\n|-------------------- CHANNEL DATA, %s (length:%4d) ------------------\n", chinfo->channelname,chinfo->blocklength+3);
+  printf("| total memory size: %d bytes\n", chinfo->blocklength+3);
+  printf("| total memory size: %d bytes\n", chinfo->memorysize);
+  printf("| memory address: %p\n", chinfo->memoryaddress);
+  printf("| header address: %p\n", chinfo->headeraddress);
+  printf("| data address  : %p\n", chinfo->dataaddress);
   printf("|------ HEADER (length:%2d) ---------------------------------------------\n",
-      (int) ((char *)chinfo.dataaddress-((char *) chinfo.headeraddress)));
-  printf("| channel name: %s\n", chinfo.channelname);
-  printf("| data block length: %d bytes\n", (int) chinfo.blocklength);
-  if(chinfo.extradatavalid){
-    if ((chinfo.extendedflag&1)==1)
+      (int) ((char *)chinfo->dataaddress-((char *) chinfo->headeraddress)));
+  printf("| channel name: %s\n", chinfo->channelname);
+  printf("| data block length: %d bytes\n", (int) chinfo->blocklength);
+  if(chinfo->extradatavalid){
+    if ((chinfo->extendedflag&1)==1)
       { printf("|   deep memory wave\n");}
     else
       { printf("|   normal wave\n"); }
-    if ((chinfo.extendedflag&2)==2)
+    if ((chinfo->extendedflag&2)==2)
       { printf("|   deep memory wave available\n"); }
     else
       { printf("|   deep memory wave not available\n"); }
   }
-  printf("| wholescreencollectingpoints: %d\n", (int) chinfo.wholescreencollectingpoints);
-  printf("| samplecount2: %d\n", (int) chinfo.numberofcollectingpoints);
-  printf("| slowmovingnumber: %d\n", (int) chinfo.slowmovingnumber);
-  printf("| timebase level: %d\n", (int) chinfo.timebaselevel);
-  printf("| zeropoint: %d\n", (int) chinfo.zeropoint);
-  printf("| vert scale level: %d\n", (int) chinfo.voltagelevel);
-  printf("| attenmultpowrindex: %d\n", (int) chinfo.attenmultpowrindex);
-  printf("| spacinginterval: %d\n", (int) chinfo.spacinginterval);
-  printf("| frequency: %d Hz\n", (int) chinfo.frequency);
-  printf("| cycle: %d\n", (int) chinfo.cycle);
-  printf("| voltvalueperpoint: %d\n", (int) chinfo.voltvalueperpoint);
-  printf("|------ DATA (length:%4d) ---------------------------------------------\n",2*chinfo.numberofcollectingpoints);
-  printf("| samples: %d. Total of 2*%d = %d bytes\n", chinfo.numberofcollectingpoints,
-      chinfo.numberofcollectingpoints, chinfo.numberofcollectingpoints*2);		
+  printf("| wholescreencollectingpoints: %d\n", (int) chinfo->wholescreencollectingpoints);
+  printf("| samplecount2: %d\n", (int) chinfo->numberofcollectingpoints);
+  printf("| slowmovingnumber: %d\n", (int) chinfo->slowmovingnumber);
+  printf("| timebase level: %d\n", (int) chinfo->timebaselevel);
+  printf("| zeropoint: %d\n", (int) chinfo->zeropoint);
+  printf("| vert scale level: %d\n", (int) chinfo->voltagelevel);
+  printf("| attenmultpowrindex: %d\n", (int) chinfo->attenmultpowrindex);
+  printf("| spacinginterval: %d\n", (int) chinfo->spacinginterval);
+  printf("| frequency: %d Hz\n", (int) chinfo->frequency);
+  printf("| cycle: %d\n", (int) chinfo->cycle);
+  printf("| voltvalueperpoint: %d\n", (int) chinfo->voltvalueperpoint);
+  printf("|------ DATA (length:%4d) ---------------------------------------------\n",2*chinfo->numberofcollectingpoints);
+  printf("| samples: %d. Total of 2*%d = %d bytes\n", chinfo->numberofcollectingpoints,
+      chinfo->numberofcollectingpoints, chinfo->numberofcollectingpoints*2);		
   printf("|--------- CALCULATED VALUES -------------------------------------------\n");
-  printf("| frequency: %e GS/s\n", chinfo.frequency/1e9);
-  printf("| time base: %e s\n", chinfo.timeBase);
-  printf("| vertical scale: %e V\n", chinfo.vertScale);
+  printf("| frequency: %e GS/s\n", chinfo->frequency/1e9);
+  printf("| time base: %e s\n", chinfo->timeBase);
+  printf("| vertical scale: %e V\n", chinfo->vertScale);
   printf("|-----------------------------------------------------------------------\n");
 }
 
-void decodeChannelHeader(char *xbuffer) {
+void decodeChannelHeader(struct owonInfo *xinf, char *xbuffer) {
   struct channelInfo chinfo;
 
-  chinfo.memoryaddress=oinfo.channels[oinfo.nchannels].memoryaddress;
-  chinfo.headeraddress=oinfo.channels[oinfo.nchannels].headeraddress;
-  chinfo.memorysize=oinfo.channels[oinfo.nchannels].memorysize;
+  chinfo.memoryaddress=xinf->channels[xinf->nchannels].memoryaddress;
+  chinfo.headeraddress=xinf->channels[xinf->nchannels].headeraddress;
+  chinfo.memorysize=xinf->channels[xinf->nchannels].memorysize;
   memcpy(&chinfo.channelname,xbuffer,3);
   chinfo.channelname[3]='\0';
   xbuffer+=3;	
@@ -112,69 +198,12 @@ void decodeChannelHeader(char *xbuffer) {
   xbuffer+=4;	
   memcpy(&chinfo.timebaselevel, xbuffer, 4);
   xbuffer+=4;
-  switch (chinfo.timebaselevel){
-    case -2: chinfo.timeBase=1.0E-9; break;
-    case -1: chinfo.timeBase=2.0E-9; break;
-    case  0: chinfo.timeBase=5.0E-9; break;
-    case  1: chinfo.timeBase=1.0E-8; break;
-    case  2: chinfo.timeBase=2.5E-8; break;
-    case  3: chinfo.timeBase=5.0E-8; break;
-    case  4: chinfo.timeBase=1.0E-7; break;
-    case  5: chinfo.timeBase=2.5E-7; break;
-    case  6: chinfo.timeBase=5.0E-7; break;
-    case  7: chinfo.timeBase=1.0E-6; break;
-    case  8: chinfo.timeBase=2.5E-6; break;
-    case  9: chinfo.timeBase=5.0E-6; break;
-    case 10: chinfo.timeBase=1.0E-5; break;
-    case 11: chinfo.timeBase=2.5E-5; break;
-    case 12: chinfo.timeBase=5.0E-5; break;
-    case 13: chinfo.timeBase=1.0E-4; break;
-    case 14: chinfo.timeBase=2.5E-4; break;
-    case 15: chinfo.timeBase=5.0E-4; break;
-    case 16: chinfo.timeBase=1.0E-3; break;
-    case 17: chinfo.timeBase=2.5E-3; break;
-    case 18: chinfo.timeBase=5.0E-3; break;
-    case 19: chinfo.timeBase=1.0E-2; break;
-    case 20: chinfo.timeBase=2.5E-2; break;
-    case 21: chinfo.timeBase=5.0E-2; break;
-    case 22: chinfo.timeBase=1.0E-1; break;
-    case 23: chinfo.timeBase=2.5E-1; break;
-    case 24: chinfo.timeBase=5.0E-1; break;
-    case 25: chinfo.timeBase=1.0; break;
-    case 26: chinfo.timeBase=2.5; break;
-    case 27: chinfo.timeBase=5.0; break;
-    case 28: chinfo.timeBase=10.0; break;
-    case 29: chinfo.timeBase=25.0; break;
-    case 30: chinfo.timeBase=50.0; break;
-    case 31: chinfo.timeBase=100.0; break;
-  }		
+  chinfo.timeBase=scaleValue(&xinf->model->timebase, chinfo.timebaselevel);
   memcpy(&chinfo.zeropoint, xbuffer, 4);
   xbuffer+=4;	
   memcpy(&chinfo.voltagelevel, xbuffer, 4);
   xbuffer+=4;
-  switch (chinfo.voltagelevel){
-    case  0: chinfo.vertScale=2E-3; break;
-    case  1: chinfo.vertScale=5E-3; break;
-    case  2: chinfo.vertScale=10E-3; break;
-    case  3: chinfo.vertScale=20E-3; break;
-    case  4: chinfo.vertScale=50E-3; break;
-    case  5: chinfo.vertScale=100E-3; break;
-    case  6: chinfo.vertScale=200E-3; break;
-    case  7: chinfo.vertScale=500E-3; break;
-    case  8: chinfo.vertScale=1.0; break;
-    case  9: chinfo.vertScale=2.0; break;
-    case 10: chinfo.vertScale=5.0; break;
-    case 11: chinfo.vertScale=10.0; break;
-    case 12: chinfo.vertScale=20.0; break;
-    case 13: chinfo.vertScale=50.0; break;
-    case 14: chinfo.vertScale=100.0; break;
-    case 15: chinfo.vertScale=200.0; break;
-    case 16: chinfo.vertScale=500.0; break;
-    case 17: chinfo.vertScale=1000.0; break;
-    case 18: chinfo.vertScale=2000.0; break;
-    case 19: chinfo.vertScale=5000.0; break;
-    case 20: chinfo.vertScale=1E4; break;
-  }	
+  chinfo.vertScale=scaleValue(&xinf->model->vertscale, chinfo.voltagelevel);
   memcpy(&chinfo.attenmultpowrindex, xbuffer, 4);
   xbuffer+=4;	
   memcpy(&chinfo.spacinginterval, xbuffer, 4);
@@ -187,60 +216,264 @@ void decodeChannelHeader(char *xbuffer) {
   xbuffer+=4;	
   chinfo.dataaddress = (short int*) xbuffer;	
 
-  oinfo.channels[oinfo.nchannels] = chinfo;
+  xinf->channels[xinf->nchannels] = chinfo;
 }
 
-int pscmp(char *s, char *t){
-  int i=0;
-  int n=strlen(t);
+// read little-endian integers from a file header:
+static int le32(const char *p){
+  const unsigned char *q = (const unsigned char *) p;
+  return((int) (q[0] | q[1]<<8 | q[2]<<16 | (unsigned int) q[3]<<24));
+}
+
+static int le16(const char *p){
+  const unsigned char *q = (const unsigned char *) p;
+  return(q[0] | q[1]<<8);
+}
+
+// write little-endian integers to a stream record:
+static void putLE(unsigned char *p, unsigned int v, int nbytes){
+  while (nbytes--) { *p++ = v & 0xff; v >>= 8; }
+}
+
+// position and number of bits of a colour mask; -1 if its bits are not contiguous
+static int maskShift(unsigned int mask, int *shift, int *bits){
+  *shift = *bits = 0;
+  if (!mask) return(0);
+  while (!(mask&1)) { mask>>=1; (*shift)++; }
+  while (mask&1) { mask>>=1; (*bits)++; }
+  return(mask ? -1 : 0);
+}
+
+// colour component of pixel v under a mask, scaled to 8 bits
+static unsigned int maskColor(unsigned int v, unsigned int mask, int shift, int bits){
+  v = (v&mask)>>shift;
+  return(bits<8 ? v<<(8-bits) : v>>(bits-8));
+}
+
+// Decode a 'BM' bitmap straight into the frame buffer of fr, which is only
+// reallocated when the screen size changes. 4, 8, 16, 24 and 32 bits per
+// pixel; 16 and 32 bits with the colour masks of the bitmap (bit fields) or
+// the default 5-5-5 and 8-8-8. The bitmap comes straight from USB, so every
+// size and offset is checked before a pixel is read.
+// Returns 0 on success.
+int decodeBitmap(char *xbuffer, int sizebuf, struct owonFrame *fr){
+  int dataoffset, infosize, width, height, bpp, compression, ncolors=0;
+  int x, y, i, tilesx, tilesy, topdown=0;
+  size_t stride, npixels;
+  unsigned char *row, *palette;
+  unsigned int *pix, v, mask[3];
+  int shift[3], bits[3];
 
-  while ((*s==*t) && (i<n)) {i++; s++; t++;}
-  if (i<n) return (0);
-  else return(1);
+  if (sizebuf<54 || xbuffer[0]!='B' || xbuffer[1]!='M') {
+    printf("ERROR: Not a bitmap\n");
+    return(-1);
+  }
+  dataoffset = le32(xbuffer+10);
+  infosize = le32(xbuffer+14);
+  width = le32(xbuffer+18);
+  height = le32(xbuffer+22);
+  bpp = le16(xbuffer+28);
+  compression = le32(xbuffer+30);
+  if (debug) printf("Bitmap %dx%d, %d bits per pixel, data at %d\n", width, height, bpp, dataoffset);
+  if ((bpp!=4 && bpp!=8 && bpp!=16 && bpp!=24 && bpp!=32) || (compression!=0 && compression!=3)
+      || (compression==3 && bpp!=16 && bpp!=32) || width<=0 || width>MAX_SCREEN_SIZE || height==0 || height<-MAX_SCREEN_SIZE || height>MAX_SCREEN_SIZE) {
+    printf("ERROR: Unsupported bitmap (%dx%d, %d bpp, compression %d)\n", width, height, bpp, compression);
+    return(-1);
+  }
+  if (height<0) { height=-height; topdown=1; }
+  if (bpp<=8) {  // palette of BGRx entries follows the info header
+    ncolors = le32(xbuffer+46);  // biClrUsed, 0 = all
+    if (ncolors<=0 || ncolors>(1<<bpp)) ncolors = 1<<bpp;
+  }
+  if (infosize<40 || infosize>sizebuf-14 || dataoffset<14+infosize+4*ncolors || dataoffset>sizebuf) {
+    printf("ERROR: Corrupt bitmap header (info size %d, data at %d, %d bytes)\n", infosize, dataoffset, sizebuf);
+    return(-1);
+  }
+  if (compression==3) {  // masks at 54: after a 40 byte info header, or inside a longer one
+    if (dataoffset<54+12) {
+      printf("ERROR: Corrupt bitmap header (no room for bit fields before data at %d)\n", dataoffset);
+      return(-1);
+    }
+    for (i=0; i<3; i++) mask[i] = (unsigned int) le32(xbuffer+54+4*i);
+  }
+  else if (bpp==16) { mask[0]=0x7c00; mask[1]=0x03e0; mask[2]=0x001f; }
+  else { mask[0]=0xff0000; mask[1]=0x00ff00; mask[2]=0x0000ff; }
+  for (i=0; i<3; i++)
+    if (maskShift(mask[i], &shift[i], &bits[i])) {
+      printf("ERROR: Unsupported bitmap colour mask %08x\n", mask[i]);
+      return(-1);
+    }
+  stride = (((size_t) width*bpp+31)/32)*4;  // rows are padded to 4 bytes
+  if ((size_t) (sizebuf-dataoffset)/stride < (size_t) height) {
+    printf("ERROR: Bitmap data of %dx%d does not fit in %d bytes\n", width, height, sizebuf);
+    return(-1);
+  }
+  npixels = (size_t) width*height;
+  if (npixels > ((size_t) -1)/sizeof(unsigned int)) return(-1);
+  palette = (unsigned char *) xbuffer+14+infosize;
+
+  if (fr->width!=width || fr->height!=height) {
+    tilesx = (width+OWON_TILE_SIZE-1)/OWON_TILE_SIZE;
+    tilesy = (height+OWON_TILE_SIZE-1)/OWON_TILE_SIZE;
+    free(fr->pixels);
+    free(fr->previous);
+    free(fr->dirty);
+    fr->pixels = malloc(npixels*sizeof(unsigned int));
+    fr->previous = malloc(npixels*sizeof(unsigned int));
+    fr->dirty = malloc(tilesx*tilesy);
+    if (!fr->pixels || !fr->previous || !fr->dirty) {
+      printf("ERROR: Failed to malloc frame buffer of %dx%d\n", width, height);
+      free(fr->pixels);
+      free(fr->previous);
+      free(fr->dirty);
+      fr->pixels = fr->previous = NULL;
+      fr->dirty = NULL;
+      fr->width = fr->height = 0;
+      return(-1);
+    }
+    fr->width = width;
+    fr->height = height;
+    fr->tilesx = tilesx;
+    fr->tilesy = tilesy;
+    fr->nframes = 0;  // new size: next frame in the stream must be complete
+  }
+
+  for (y=0; y<height; y++){
+    row = (unsigned char *) xbuffer+dataoffset+stride*(topdown ? y : height-1-y);
+    pix = fr->pixels+(size_t) y*width;
+    for (x=0; x<width; x++){
+      switch (bpp){
+        case 4:  v = (row[x/2] >> ((x&1) ? 0 : 4)) & 0x0f;
+                 v = (v<(unsigned int) ncolors) ? (palette[4*v+2]<<16 | palette[4*v+1]<<8 | palette[4*v]) : 0;
+                 break;
+        case 8:  v = row[x];
+                 v = (v<(unsigned int) ncolors) ? (palette[4*v+2]<<16 | palette[4*v+1]<<8 | palette[4*v]) : 0;
+                 break;
+        case 16: v = row[2*x] | row[2*x+1]<<8;
+                 v = maskColor(v, mask[0], shift[0], bits[0])<<16 | maskColor(v, mask[1], shift[1], bits[1])<<8
+                   | maskColor(v, mask[2], shift[2], bits[2]);
+                 break;
+        case 24: v = row[3*x+2]<<16 | row[3*x+1]<<8 | row[3*x]; break;
+        default: v = row[4*x] | row[4*x+1]<<8 | row[4*x+2]<<16 | (unsigned int) row[4*x+3]<<24;
+                 v = maskColor(v, mask[0], shift[0], bits[0])<<16 | maskColor(v, mask[1], shift[1], bits[1])<<8
+                   | maskColor(v, mask[2], shift[2], bits[2]);
+                 break;
+      }
+      pix[x] = v;
+    }
+  }
+  return(0);
+}
+
+// Mark the tiles of OWON_TILE_SIZE x OWON_TILE_SIZE pixels that changed since
+// the last frame written with saveScreenshotStream(). A moving trace and a
+// changing readout only mark their own tiles. Returns the number of dirty tiles.
+int owonFrameDelta(struct owonFrame *fr){
+  int tx, ty, y, y1, x0, w;
+  unsigned char *d;
+
+  fr->ndirty = 0;
+  for (ty=0; ty<fr->tilesy; ty++){
+    y1 = (ty+1)*OWON_TILE_SIZE;
+    if (y1>fr->height) y1=fr->height;
+    for (tx=0; tx<fr->tilesx; tx++){
+      d = &fr->dirty[ty*fr->tilesx+tx];
+      *d = (fr->nframes==0);  // nothing to compare with: all is new
+      x0 = tx*OWON_TILE_SIZE;
+      w = (x0+OWON_TILE_SIZE>fr->width) ? fr->width-x0 : OWON_TILE_SIZE;
+      for (y=ty*OWON_TILE_SIZE; y<y1 && !*d; y++)
+        *d = memcmp(fr->pixels+(size_t) y*fr->width+x0, fr->previous+(size_t) y*fr->width+x0,
+            w*sizeof(unsigned int))!=0;
+      fr->ndirty += *d;
+    }
+  }
+  return(fr->ndirty);
+}
+
+// Append the current frame to a screenshot stream. Every record is
+// "OWF" + frame number (4 bytes) + width, height, tile size (2 bytes each)
+// + number of dirty tiles (4 bytes), all little endian. If there are dirty
+// tiles, a bitmap of one bit per tile follows (row by row, lsb first), then
+// the pixels of every dirty tile as RGB, row by row. Returns 0 on success.
+int saveScreenshotStream(FILE *fp, struct owonFrame *fr){
+  unsigned char rec[17];
+  unsigned char *buf, *q;
+  unsigned int *p;
+  int i, tx, ty, x, y, y1, x0, w, nbits, size;
+
+  if (!fr->pixels) return(-1);
+  owonFrameDelta(fr);
+  memcpy(rec, "OWF", 3);
+  putLE(rec+3, fr->nframes, 4);
+  putLE(rec+7, fr->width, 2);
+  putLE(rec+9, fr->height, 2);
+  putLE(rec+11, OWON_TILE_SIZE, 2);
+  putLE(rec+13, fr->ndirty, 4);
+  if (fwrite(rec, 1, 17, fp)!=17) return(-1);
+  if (fr->ndirty>0) {
+    nbits = fr->tilesx*fr->tilesy;
+    size = (nbits+7)/8;  // buf holds the tile bitmap, then one row of a tile
+    if (size<3*OWON_TILE_SIZE) size = 3*OWON_TILE_SIZE;
+    buf = calloc(1, size);
+    if (!buf) return(-1);
+    for (i=0; i<nbits; i++)
+      if (fr->dirty[i]) buf[i/8] |= 1<<(i%8);
+    if (fwrite(buf, 1, (nbits+7)/8, fp)!=(size_t) (nbits+7)/8) { free(buf); return(-1); }
+    for (ty=0; ty<fr->tilesy; ty++)
+      for (tx=0; tx<fr->tilesx; tx++){
+        if (!fr->dirty[ty*fr->tilesx+tx]) continue;
+        x0 = tx*OWON_TILE_SIZE;
+        w = (x0+OWON_TILE_SIZE>fr->width) ? fr->width-x0 : OWON_TILE_SIZE;
+        y1 = (ty+1)*OWON_TILE_SIZE;
+        if (y1>fr->height) y1=fr->height;
+        for (y=ty*OWON_TILE_SIZE; y<y1; y++){
+          p = fr->pixels+(size_t) y*fr->width+x0;
+          for (x=0, q=buf; x<w; x++){
+            *q++ = p[x]>>16;
+            *q++ = p[x]>>8;
+            *q++ = p[x];
+          }
+          if (fwrite(buf, 3, w, fp)!=(size_t) w) { free(buf); return(-1); }
+          memcpy(fr->previous+(size_t) y*fr->width+x0, p, w*sizeof(unsigned int));
+        }
+      }
+    free(buf);
+  }
+  if (debug) printf("Screenshot %d: %d of %d tiles changed\n", fr->nframes,
+      fr->ndirty, fr->tilesx*fr->tilesy);
+  fr->nframes++;
+  return(0);
 }
 
-void decodeFileHeader(char *xbuffer, int sizebuf){
+// fr receives a bitmap, NULL if the caller does not want it decoded
+void decodeFileHeader(struct owonSession *s, char *xbuffer, int sizebuf, struct owonFrame *fr){
   // only at first channel data!
   time_t timestamp;
+  struct tm tm;
 
     //determine from the header whether this is bitmap data or vectorgram
     // is it a 'BM' (bitmap) ?
   if(*xbuffer=='B' &&  *(xbuffer+1)=='M'){
-        printf("Found 640x480 bitmap of %04xh (%d) bytes\n", (int) *(xbuffer+2), *(xbuffer+2));
+    printf("Found bitmap of %04xh (%d) bytes\n", le32(xbuffer+2), le32(xbuffer+2));
+    if (fr) decodeBitmap(xbuffer, sizebuf, fr);
   }
     // is it a vectorgram ('SPB') ?   If so, we decode the contents
   else if(*xbuffer=='S' &&  *(xbuffer+1)=='P' && *(xbuffer+2)=='B') {
     if (debug) printf("Found vector data:\n");
-    memcpy(&oinfo.idn, xbuffer, 6);
-    oinfo.idn[6]='\0';
-    if (debug) printf("    File description: %s\n", oinfo.idn);
-    if (vgramheaderlength<20){
-      if (pscmp(xbuffer, "SPBW01")) strcpy(oinfo.devicename, "PDS6062x");
-      else if (pscmp(xbuffer, "SPBW11")) strcpy(oinfo.devicename, "HDS2062M");
-      else if (pscmp(xbuffer, "SPBW10")) strcpy(oinfo.devicename, "HDS2062N");
-      else if (pscmp(xbuffer, "SPBV01")) strcpy(oinfo.devicename, "PDS5022S");
-      else if (pscmp(xbuffer, "SPBV10")) strcpy(oinfo.devicename, "HDS1022N");
-      else if (pscmp(xbuffer, "SPBV11")) strcpy(oinfo.devicename, "HDS1022M");
-      else if (pscmp(xbuffer, "SPBV12")) strcpy(oinfo.devicename, "HDS1021M");
-      else if (pscmp(xbuffer, "SPBX01")) strcpy(oinfo.devicename, "MSO7102");
-      else if (pscmp(xbuffer, "SPBX10")) strcpy(oinfo.devicename, "HDS3102N");
-      else if (pscmp(xbuffer, "SPBM01")) strcpy(oinfo.devicename, "MSO8202");
-      else if (pscmp(xbuffer, "SPBS01")) strcpy(oinfo.devicename, "SDS6062");
-      else if (pscmp(xbuffer, "SPBS02")) strcpy(oinfo.devicename, "SDS7102");
-      else if (pscmp(xbuffer, "SPBS03")) strcpy(oinfo.devicename, "SDS8202");
-      else if (pscmp(xbuffer, "SPBS04")) strcpy(oinfo.devicename, "SDS9302");
-      else strcpy(oinfo.devicename, "unknown");
-      if (debug) printf("    Device name: Owon %s\n", oinfo.devicename);
-    }
-    xbuffer+=6;
-    oinfo.memorysize=sizebuf;
-    if (debug) printf("    File length: %d bytes\n", oinfo.memorysize);
-    xbuffer+=13;
-    if (vgramheaderlength>19){
-      memcpy(&oinfo.devicename, xbuffer, 7);
-      oinfo.devicename[7]='\0';
-      if (debug) printf("    Device name: Owon %s\n", oinfo.devicename);
+    memcpy(&s->info.idn, xbuffer, 6);
+    s->info.idn[6]='\0';
+    if (debug) printf("    File description: %s\n", s->info.idn);
+    s->info.model = findOwonModel(xbuffer);
+    s->info.memorysize=sizebuf;
+    if (debug) printf("    File length: %d bytes\n", s->info.memorysize);
+      // device name from the header where the model has it there, else the registry name
+    if (s->info.model->namelength>0 && s->info.model->nameoffset+s->info.model->namelength<=s->vgramheaderlength){
+      memcpy(&s->info.devicename, xbuffer+s->info.model->nameoffset, s->info.model->namelength);
+      s->info.devicename[s->info.model->namelength]='\0';
     }
+    else
+      strcpy(s->info.devicename, s->info.model->name);
+    if (debug) printf("    Device name: Owon %s\n", s->info.devicename);
   }
     // not a BM nor a SPB:
   else {
@@ -248,10 +481,10 @@ void decodeFileHeader(char *xbuffer, int sizebuf){
     printf("%c %c %c %c\n", *xbuffer, *(xbuffer+1), *(xbuffer+2), *(xbuffer+3));
   }
   timestamp = time(NULL);
-  strftime(oinfo.timestring, 21, "%d/%h/%Y %H:%M:%S", localtime(&timestamp));
+  strftime(s->info.timestring, 21, "%d/%h/%Y %H:%M:%S", localtime_r(&timestamp, &tm));
   if (debug){
     printf("Time stamp. Seconds since 1 January 1970: %ld\n", timestamp);
-    printf("Time: %s\n", oinfo.timestring);
+    printf("Time: %s\n", s->info.timestring);
   }
 }
 
@@ -336,22 +569,43 @@ redundantzero:	// e+05 can be written as e+5, e+005 as e+5, etc.
   }
 }
 
+// number of samples of a channel that really are in its memory block; the
+// count in the header is not trusted after a short read or a corrupt header
+int owonSampleCount(const struct channelInfo *chinfo){
+  long avail;
+
+  if (!chinfo->dataaddress || !chinfo->memoryaddress) return(0);
+  avail = ((char *) chinfo->memoryaddress+chinfo->memorysize-(char *) chinfo->dataaddress)/2;
+  if (avail<0) avail = 0;
+  if (chinfo->numberofcollectingpoints<avail) avail = chinfo->numberofcollectingpoints;
+  return(avail<0 ? 0 : (int) avail);
+}
+
+// time (s) of sample j, relative to the first sample
+double owonSampleTime(const struct channelInfo *chinfo, int j){
+  return(((double) j)*chinfo->timeBase/500.0);
+}
+
+// voltage (V) of sample j
+double owonSampleVolt(const struct channelInfo *chinfo, int j){
+  return(chinfo->dataaddress[j]*chinfo->vertScale/25.0);
+}
+
 void saveData(FILE *ff){
-  int ichan, j;
+  int ichan, j, n;
   char s[255];
-  short int *ip[MAX_CHANNELS];
 
-  for (ichan=0; ichan<oinfo.nchannels; ichan++)
-    ip[ichan] = oinfo.channels[ichan].dataaddress;
-  for (j=0; j<oinfo.channels[0].numberofcollectingpoints; j++){
-    sprintf(s, "%e", ((double) j)*oinfo.channels[0].timeBase/500.0);
+  n = owonSampleCount(&oinfo.channels[0]);
+  for (ichan=1; ichan<oinfo.nchannels; ichan++)
+    if (owonSampleCount(&oinfo.channels[ichan])<n) n = owonSampleCount(&oinfo.channels[ichan]);
+  for (j=0; j<n; j++){
+    sprintf(s, "%e", owonSampleTime(&oinfo.channels[0], j));
     cleanString(s);
     fprintf(ff, "%s", s);
     for (ichan=0; ichan<oinfo.nchannels; ichan++){
-      sprintf(s, "%e", (*ip[ichan])*oinfo.channels[ichan].vertScale/25.0);
+      sprintf(s, "%e", owonSampleVolt(&oinfo.channels[ichan], j));
       cleanString(s);
       fprintf(ff, " %s", s);
-      ip[ichan]++;
     } 
     fprintf(ff, "\n");
   }	
@@ -394,16 +648,16 @@ void saveDataMatlab(char *fname){
   fclose(fout);	
 }
 
-int owonCommand(char *cmd){
+int owonSessionCommand(struct owonSession *s, char *cmd){
   int ret=0;
 
-      // clear any halt status on the bulk OUT endpoint
-  ret = usb_clear_halt(devhandle, BULK_WRITE_ENDPOINT);
   if (debug) printf("Trying to bulk write %s command to device.\n",cmd);
-  ret = usb_bulk_write(devhandle, BULK_WRITE_ENDPOINT, cmd,
+  ret = usb_bulk_write(s->devhandle, BULK_WRITE_ENDPOINT, cmd,
   strlen(cmd), DEFAULT_TIMEOUT);
   if(ret < 0) {
     printf("ERROR: Failed to bulk write %04x '%s'\n", ret, strerror(-ret));
+      // clear any halt status on the bulk OUT endpoint for the next command
+    usb_clear_halt(s->devhandle, BULK_WRITE_ENDPOINT);
     return(ret);
   }
   if (debug) printf("--Successful bulk write of 0x%04x bytes\n",
@@ -411,7 +665,65 @@ int owonCommand(char *cmd){
     return(0);
 }
 
-int openCommunication(struct usb_device *dev){
+static double secondsSince(struct timespec *t0){
+  struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return((t.tv_sec-t0->tv_sec) + (t.tv_nsec-t0->tv_nsec)*1e-9);
+}
+
+// Send a batch of commands. All commands are written back to back, then the
+// replies that are expected (reply!=NULL) are read in the same order. The
+// batch stops at the first failed (or short) write: the commands after it
+// are not sent, so a setup is never half applied before e.g. STARTBIN.
+// Returns the number of commands that did not complete.
+int owonSessionCommandBatch(struct owonSession *s, struct owonCommandItem *items, int n){
+  int i, ret, len, nsent, nfailed=0;
+  struct timespec t0;
+
+  if (debug) printf("Trying to bulk write a batch of %d commands to device.\n", n);
+  for (i=0; i<n; i++){
+    items[i].written = OWON_CMD_NOT_SENT;
+    items[i].read = 0;
+    items[i].latency = 0.0;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  for (nsent=0; nsent<n; nsent++){
+    len = strlen(items[nsent].cmd);
+    ret = usb_bulk_write(s->devhandle, BULK_WRITE_ENDPOINT, items[nsent].cmd,
+        len, DEFAULT_TIMEOUT);
+    items[nsent].written = ret;
+    items[nsent].latency = secondsSince(&t0);
+    if (ret != len) {
+      if (ret < 0) {
+        printf("ERROR: Failed to bulk write %04x '%s' for command %s\n", ret, strerror(-ret), items[nsent].cmd);
+        usb_clear_halt(s->devhandle, BULK_WRITE_ENDPOINT);
+      }
+      else
+        printf("ERROR: Short bulk write of %d of %d bytes for command %s\n", ret, len, items[nsent].cmd);
+      printf("  not sending the remaining %d commands of the batch\n", n-nsent-1);
+      nfailed = n-nsent;
+      break;
+    }
+    if (debug) printf("--Successful bulk write of %s\n", items[nsent].cmd);
+  }
+  for (i=0; i<nsent; i++){  // only commands that were written completely
+    if (!items[i].reply) continue;
+    ret = usb_bulk_read(s->devhandle, BULK_READ_ENDPOINT, items[i].reply,
+        items[i].replysize, DEFAULT_TIMEOUT);
+    items[i].read = ret;
+    items[i].latency = secondsSince(&t0);
+    if (ret < 0) {
+      printf("ERROR: Failed to read reply to %s: '%s'\n", items[i].cmd, strerror(-ret));
+      usb_clear_halt(s->devhandle, BULK_READ_ENDPOINT);
+      nfailed++;
+    }
+    else if (debug) printf("--Successful read of %d bytes reply to %s\n", ret, items[i].cmd);
+  }
+  return(nfailed);
+}
+
+int owonSessionOpen(struct owonSession *s, struct usb_device *dev){
   signed int ret=0;	// set to < 0 to indicate USB errors
   char owondescriptorbuffer[0x12];
 
@@ -422,10 +734,10 @@ int openCommunication(struct usb_device *dev){
 
   if (debug) printf("Trying USB lock on device %04x:%04x\n",
       dev->descriptor.idVendor, dev->descriptor.idProduct);
-  devhandle = usb_open(dev);
-  if(devhandle > 0) {
+  s->devhandle = usb_open(dev);
+  if(s->devhandle > 0) {
     if (debug) printf("--device locked\nTrying to set device to default configuration\n");
-    ret = usb_set_configuration(devhandle, DEFAULT_CONFIGURATION);
+    ret = usb_set_configuration(s->devhandle, DEFAULT_CONFIGURATION);
     if(ret) {
       if (debug) printf("\n"); 
       printf("ERROR: Failed to set default configuration %d '%s'\n", ret, strerror(-ret));
@@ -438,9 +750,10 @@ int openCommunication(struct usb_device *dev){
 
     if (debug) printf("Trying to claim interface 0 of %04x:%04x and\n",
       dev->descriptor.idVendor, dev->descriptor.idProduct);
-    ret = usb_claim_interface(devhandle, DEFAULT_INTERFACE);
-    ret += usb_clear_halt(devhandle, BULK_READ_ENDPOINT);
-    ret += usb_set_altinterface(devhandle, DEFAULT_INTERFACE);
+    ret = usb_claim_interface(s->devhandle, DEFAULT_INTERFACE);
+    ret += usb_clear_halt(s->devhandle, BULK_READ_ENDPOINT);
+    ret += usb_clear_halt(s->devhandle, BULK_WRITE_ENDPOINT);
+    ret += usb_set_altinterface(s->devhandle, DEFAULT_INTERFACE);
     if(ret) {
       printf("ERROR: Failed to claim interface %d: %d : \'%s\'\n", DEFAULT_INTERFACE, ret, strerror(-ret));
       return(ret);
@@ -454,7 +767,7 @@ int openCommunication(struct usb_device *dev){
   }
 
   if (debug) printf("Trying to get the device descriptor\n");
-  ret = usb_get_descriptor(devhandle, USB_DT_DEVICE, 0x00, owondescriptorbuffer, 0x12);
+  ret = usb_get_descriptor(s->devhandle, USB_DT_DEVICE, 0x00, owondescriptorbuffer, 0x12);
  	if(ret < 0) {
     printf("ERROR: Failed to get device descriptor %04x '%s'\n", ret, strerror(-ret));
     return(ret);
@@ -464,57 +777,144 @@ int openCommunication(struct usb_device *dev){
   return(0);  // no error
 } 
 
-int determineVectorgramHeaderLength(char *xbuf){
+int determineVectorgramHeaderLength(char *xbuf, int sizebuf){
   char *searchstring = "CH";
   int i=0, m=0;
 
-  while ((m<2)&&(i<100))
+  while ((m<2)&&(i<100)&&(i<sizebuf))
     if (searchstring[m]==xbuf[i++]) m++;
   if (m==2) return(i-2); else return(0);
 }
 
-int closeCommunication(){
+int owonSessionClose(struct owonSession *s){
   int ret=0;
 
   if (debug) printf("Trying to release interface %d\n", DEFAULT_INTERFACE);
-  ret = usb_release_interface(devhandle, DEFAULT_INTERFACE);
+  ret = usb_release_interface(s->devhandle, DEFAULT_INTERFACE);
   if(ret) {
     printf("ERROR: Failed to release interface %d: '%s'\n", DEFAULT_INTERFACE, strerror(-ret));
     return(ret);
   }
   if (debug) printf("--Successful release of interface %d\n", DEFAULT_INTERFACE);
 
-  usb_reset(devhandle);
-  usb_close(devhandle);
+  usb_reset(s->devhandle);
+  usb_close(s->devhandle);
   return(0);
 }
 
-void owonReadMemory(struct usb_device *dev) {
-  signed int ret=0;	// set to < 0 to indicate USB errors
+// Decode one channel block as read from the Owon (the first one starts with
+// the file header) and add it to s->info. Used by owonSessionRead, but works on
+// any buffer in memory; the headers are checked against owondatabuffersize
+// before they are read. Returns 0 on success.
+int owonSessionDecode(struct owonSession *s, char *owondatabuffer, unsigned int owondatabuffersize){
   int i=0, j=0;
   char *channelptr;	 // points to the start of a channel
+
+  if (s->info.nchannels>=MAX_CHANNELS) {
+    printf("ERROR: More than %d channels\n", MAX_CHANNELS);
+    return(-1);
+  }
+  s->info.channels[s->info.nchannels].memoryaddress = owondatabuffer;
+  s->info.channels[s->info.nchannels].memorysize = owondatabuffersize;
+  if (s->info.nchannels==0){  // File header only at the FIRST channel!!!
+    if (debug) { // let's take a look in memory there:
+        // hexdump the first 0x40 bytes of the Owon Data Buffer
+      printf("Hexdump of first 0x40 bytes of the Owon data buffer :\n");
+      for(i=0; i<=0x03 && (i+1)*0x10<=owondatabuffersize; i++) {
+        printf("\t%07x0: ",i);
+        for(j=0;j<0x10;j++)
+        printf("%02x ", (unsigned char) owondatabuffer[(i*0x10)+j]);
+        printf("\n");
+        printf("\t        : ");
+        for(j=0;j<0x10;j++)
+          printf(" %c ", (char) owondatabuffer[(i*0x10)+j]);
+        printf("\n");
+      }
+    }
+      // look for 'CH' in data buffer to determine header length
+    if (debug) printf("Determining file header length:\n");
+    s->vgramheaderlength = determineVectorgramHeaderLength(owondatabuffer, owondatabuffersize);
+    if (s->vgramheaderlength==0) {
+      printf("Vectogram header end ('CH') not found\n");
+      return(-1);
+    }
+    else if (debug) printf("--File header length = %d bytes\n", s->vgramheaderlength);
+    if (s->vgramheaderlength+VECTORGRAM_CHANNEL_HEADER_LENGTH > owondatabuffersize) {
+      printf("ERROR: File and channel header do not fit in %d bytes\n", owondatabuffersize);
+      return(-1);
+    }
+        // extract information about the file:
+    decodeFileHeader(s, owondatabuffer, owondatabuffersize, s->frame);
+    s->info.startaddress=owondatabuffer;
+    if (debug) printFileInfo(&s->info);
+      //finfo.channels[0].memoryaddress = owondatabuffer;
+    s->info.channels[0].headeraddress = owondatabuffer+s->vgramheaderlength;	
+  }
+  else {  // data only contains channel, without Vectorgram description header
+    s->info.channels[s->info.nchannels].headeraddress = owondatabuffer;	
+  }
+
+    // initialize the header pointer to the first header in the data
+  channelptr = s->info.channels[s->info.nchannels].headeraddress;
+  if (channelptr-owondatabuffer+VECTORGRAM_CHANNEL_HEADER_LENGTH > (long) owondatabuffersize) {
+    printf("ERROR: Channel header does not fit in %d bytes\n", owondatabuffersize);
+    return(-1);
+  }
+
+  if (debug){	
+    printf("Owon Data Buffer info:\n");
+    printf("    owondatabuffer pointer = 0x%p\n", owondatabuffer);
+    printf("    owondatabuffersize = 0x%x (%d)\n", owondatabuffersize, owondatabuffersize);
+    printf("    VECTORGRAM_FILE_HDR_LENGTH= 0x%02x\n", s->vgramheaderlength);
+    printf("    channelptr = 0x%p\n", channelptr);
+    printf("    owondatabuffer+vgramheaderlength = 0x%p\n", owondatabuffer+s->vgramheaderlength);
+  }
+
+  if (debug && s->rawfilename) writeRawData(owondatabuffer, owondatabuffersize, s->rawfilename);
+
+  if (debug) {
+     // hexdump the first 0x40 bytes of channel header
+ 	  printf("Hexdump of channel header:\n");
+    for(i=0; i<=0x04 && channelptr-owondatabuffer+(i+1)*0x10<=owondatabuffersize; i++) {
+      printf("\t%07x0: ",i);
+      for(j=0;j<0x10;j++)
+        printf("%02x ", (unsigned char) *(channelptr+(i*0x10)+j));
+      printf("\n");
+      printf("\t ASCII  : ");
+      for(j=0;j<0x10;j++)
+        printf(" %c ", (char) *(channelptr+(i*0x10)+j));
+      printf("\n");
+    }
+  }
+
+  decodeChannelHeader(&s->info, channelptr);
+
+  s->info.nchannels++;
+  return(0);
+}
+
+void owonSessionRead(struct owonSession *s) {
+  signed int ret=0;	// set to < 0 to indicate USB errors
+  int i=0;
   int owonflag;
   unsigned int owondatabuffersize=0;
   char responseheader[RESPONSE_START_LENGTH];  // 12-byte reply from Owon
   char *owondatabuffer;
 
   if (debug) printf("Entering readOwonMemory:\n");
-  if (owonCommand(OWON_START_DATA_CMD)){
+  if (owonSessionCommand(s, OWON_START_DATA_CMD)){
     printf("ERROR: Failed write comamnd %s\n", OWON_START_DATA_CMD);
     return;
   }
 
-  // clear any halt status on the bulk IN endpoint
-  ret = usb_clear_halt(devhandle, BULK_READ_ENDPOINT);
-
-  oinfo.nchannels=0;
+  s->info.nchannels=0;
 
 readnextchannel:
   if (debug) printf("Trying to read response header %d bytes from device.\n", (unsigned int) RESPONSE_START_LENGTH);
-  ret = usb_bulk_read(devhandle, BULK_READ_ENDPOINT, responseheader,
+  ret = usb_bulk_read(s->devhandle, BULK_READ_ENDPOINT, responseheader,
       RESPONSE_START_LENGTH, DEFAULT_TIMEOUT);
   if(ret<0) {
-    usb_resetep(devhandle,BULK_READ_ENDPOINT);
+    usb_resetep(s->devhandle,BULK_READ_ENDPOINT);
     printf("ERROR: Failed to read: %d bytes: '%s'\n", (unsigned int) RESPONSE_START_LENGTH, strerror(-ret));
     return;
   }
@@ -534,10 +934,14 @@ readnextchannel:
   if (debug) printf("dataBufSize = 0x%08x (%d) bytes\n", owondatabuffersize,
        owondatabuffersize);
 
+  if (s->info.nchannels>=MAX_CHANNELS) {
+    printf("ERROR: More than %d channels\n", MAX_CHANNELS);
+    return;
+  }
   if (debug) printf("Trying to reserve memory space for the read buffer of 0x%08x (%d) bytes\n", owondatabuffersize, owondatabuffersize);
-  oinfo.channels[oinfo.nchannels].memoryaddress = malloc(owondatabuffersize);
-  oinfo.channels[oinfo.nchannels].memorysize = owondatabuffersize;
-  owondatabuffer = oinfo.channels[oinfo.nchannels].memoryaddress;
+  s->info.channels[s->info.nchannels].memoryaddress = malloc(owondatabuffersize);
+  s->info.channels[s->info.nchannels].memorysize = owondatabuffersize;
+  owondatabuffer = s->info.channels[s->info.nchannels].memoryaddress;
   if(!owondatabuffer) {
     printf("ERROR: Failed to malloc(0x%08xh)!\n", owondatabuffersize);
     return;
@@ -551,92 +955,176 @@ readnextchannel:
   if (debug) printf("Owon ready to bulk transfer %08xh (%d) bytes\n", owondatabuffersize, owondatabuffersize);
 
   if (debug) printf("Trying to bulk read %08xh (%d) bytes from device\n", owondatabuffersize, owondatabuffersize);
-  ret = usb_bulk_read(devhandle, BULK_READ_ENDPOINT, owondatabuffer,
+  ret = usb_bulk_read(s->devhandle, BULK_READ_ENDPOINT, owondatabuffer,
   owondatabuffersize, DEFAULT_BITMAP_READ_TIMEOUT);
   if(ret < 0) {
     printf("ERROR: Failed to bulk read: %xh (%d) bytes: %d - '%s'\n", owondatabuffersize, owondatabuffersize, ret, strerror(-ret));
-    usb_reset(devhandle);
+    usb_reset(s->devhandle);
     return;
   }
   else
     { if (debug) printf("Successful bulk read of 0x%08x (%d) bytes\n", ret, ret);}
 
-    // Information is in the buffer starting at address owondatabuffer
+    // Information is in the buffer starting at address owondatabuffer;
+    // after a short read only the first ret bytes of it are valid
+  if ((unsigned int) ret<owondatabuffersize && debug) printf("Short read: %d of %d bytes\n", ret, owondatabuffersize);
+  if (owonSessionDecode(s, owondatabuffer, ret)) return;
 
-  oinfo.channels[oinfo.nchannels].memoryaddress = owondatabuffer;
-  if (oinfo.nchannels==0){  // File header only at the FIRST channel!!!
-    if (debug) { // let's take a look in memory there:
-        // hexdump the first 0x40 bytes of the Owon Data Buffer
-      printf("Hexdump of first 0x40 bytes of the Owon data buffer :\n");
-      for(i=0; i<=0x03; i++) {
-        printf("\t%07x0: ",i);
-        for(j=0;j<0x10;j++)
-        printf("%02x ", (unsigned char) owondatabuffer[(i*0x10)+j]);
-        printf("\n");
-        printf("\t        : ");
-        for(j=0;j<0x10;j++)
-          printf(" %c ", (char) owondatabuffer[(i*0x10)+j]);
-        printf("\n");
-      }
-    }
-      // look for 'CH' in data buffer to determine header length
-    if (debug) printf("Determining file header length:\n");
-    vgramheaderlength = determineVectorgramHeaderLength(owondatabuffer);
-    if (vgramheaderlength==0) {
-      printf("Vectogram header end ('CH') not found\n");
-      return;
-    }
-    else if (debug) printf("--File header length = %d bytes\n", vgramheaderlength);
-        // extract information about the file:
-    decodeFileHeader(owondatabuffer, owondatabuffersize);
-    oinfo.startaddress=owondatabuffer;
-    printFileInfo(oinfo);
-      //finfo.channels[0].memoryaddress = owondatabuffer;
-    oinfo.channels[0].headeraddress = owondatabuffer+vgramheaderlength;	
-  }
-  else {  // data only contains channel, without Vectorgram description header
-    oinfo.channels[oinfo.nchannels].headeraddress = owondatabuffer;	
-  }
+  if (owonflag>128){
+    if (debug) printf("\nOwon 3rd-int flag>128: We're still not done yet!!\n");
+    goto readnextchannel;
+  }	
 
-    // initialize the header pointer to the first header in the data
-  channelptr = oinfo.channels[oinfo.nchannels].headeraddress;
+  return;
+}
 
-  if (debug){	
-    printf("Owon Data Buffer info:\n");
-    printf("    owondatabuffer pointer = 0x%p\n", owondatabuffer);
-    printf("    owondatabuffersize = 0x%x (%d)\n", owondatabuffersize, owondatabuffersize);
-    printf("    VECTORGRAM_FILE_HDR_LENGTH= 0x%02x\n", vgramheaderlength);
-    printf("    channelptr = 0x%p\n", channelptr);
-    printf("    owondatabuffer+vgramheaderlength = 0x%p\n", owondatabuffer+vgramheaderlength);
-  }
+// A session holds everything of one scope, so different scopes can be read
+// at the same time from different threads.
+void owonSessionInit(struct owonSession *s){
+  memset(s, 0, sizeof(struct owonSession));
+  s->info.model = &owonUnknownModel;
+}
 
-  if (debug) writeRawData(owondatabuffer, owondatabuffersize, "output.bin");
+// The functions without session work on the globals devhandle, oinfo,
+// vgramheaderlength and oframe, for programs that talk to one scope at a time.
+static void loadSession(struct owonSession *s){
+  s->devhandle = devhandle;
+  s->vgramheaderlength = vgramheaderlength;
+  s->info = oinfo;
+  s->frame = &oframe;
+  s->rawfilename = "output.bin";
+}
 
-  if (debug) {
-     // hexdump the first 0x40 bytes of channel header
- 	  printf("Hexdump of channel header:\n");
-    for(i=0; i<=0x04; i++) {
-      printf("\t%07x0: ",i);
-      for(j=0;j<0x10;j++)
-        printf("%02x ", (unsigned char) *(channelptr+(i*0x10)+j));
-      printf("\n");
-      printf("\t ASCII  : ");
-      for(j=0;j<0x10;j++)
-        printf(" %c ", (char) *(channelptr+(i*0x10)+j));
-      printf("\n");
+static void storeSession(struct owonSession *s){
+  devhandle = s->devhandle;
+  vgramheaderlength = s->vgramheaderlength;
+  oinfo = s->info;
+}
+
+int owonCommand(char *cmd){
+  struct owonSession s;
+
+  loadSession(&s);
+  return(owonSessionCommand(&s, cmd));
+}
+
+int owonCommandBatch(struct owonCommandItem *items, int n){
+  struct owonSession s;
+
+  loadSession(&s);
+  return(owonSessionCommandBatch(&s, items, n));
+}
+
+int openCommunication(struct usb_device *dev){
+  struct owonSession s;
+  int ret;
+
+  loadSession(&s);
+  ret = owonSessionOpen(&s, dev);
+  storeSession(&s);
+  return(ret);
+}
+
+int closeCommunication(){
+  struct owonSession s;
+
+  loadSession(&s);
+  return(owonSessionClose(&s));
+}
+
+int decodeOwonBuffer(char *owondatabuffer, unsigned int owondatabuffersize){
+  struct owonSession s;
+  int ret;
+
+  loadSession(&s);
+  ret = owonSessionDecode(&s, owondatabuffer, owondatabuffersize);
+  storeSession(&s);
+  return(ret);
+}
+
+void owonReadMemory(struct usb_device *dev) {
+  struct owonSession s;
+
+  loadSession(&s);
+  owonSessionRead(&s);
+  storeSession(&s);
+}
+
+// Read a screenshot into fr. The USB read buffer is kept in fr and reused,
+// the bitmap is decoded from it directly into the frame buffer.
+int owonSessionReadScreenshot(struct owonSession *s, struct owonFrame *fr){
+  signed int ret=0;
+  int size;
+  char responseheader[RESPONSE_START_LENGTH];
+  char *p;
+
+  if (debug) printf("Entering owonSessionReadScreenshot:\n");
+  if (owonSessionCommand(s, OWON_START_BMP_CMD)){
+    printf("ERROR: Failed write comamnd %s\n", OWON_START_BMP_CMD);
+    return(-1);
+  }
+  ret = usb_bulk_read(s->devhandle, BULK_READ_ENDPOINT, responseheader,
+      RESPONSE_START_LENGTH, DEFAULT_TIMEOUT);
+  if(ret<0) {
+    usb_resetep(s->devhandle,BULK_READ_ENDPOINT);
+    printf("ERROR: Failed to read: %d bytes: '%s'\n", (unsigned int) RESPONSE_START_LENGTH, strerror(-ret));
+    return(ret);
+  }
+  memcpy(&size,responseheader,4);
+  if (debug) printf("Bitmap size = 0x%08x (%d) bytes\n", size, size);
+  if (size<=0) return(-1);
+  if (size>fr->readbuffersize) {
+    p = realloc(fr->readbuffer, size);
+    if (!p) {
+      printf("ERROR: Failed to malloc(0x%08xh)!\n", size);
+      return(-1);
     }
+    fr->readbuffer = p;
+    fr->readbuffersize = size;
   }
+  ret = usb_bulk_read(s->devhandle, BULK_READ_ENDPOINT, fr->readbuffer,
+      size, DEFAULT_BITMAP_READ_TIMEOUT);
+  if(ret < 0) {
+    printf("ERROR: Failed to bulk read: %xh (%d) bytes: %d - '%s'\n", size, size, ret, strerror(-ret));
+    usb_reset(s->devhandle);
+    return(ret);
+  }
+  else
+    { if (debug) printf("Successful bulk read of 0x%08x (%d) bytes\n", ret, ret);}
+  return(decodeBitmap(fr->readbuffer, ret, fr));
+}
 
-  decodeChannelHeader(channelptr);
+int owonReadScreenshot(struct owonFrame *fr){
+  struct owonSession s;
 
-  oinfo.nchannels++;
+  loadSession(&s);
+  return(owonSessionReadScreenshot(&s, fr));
+}
 
-  if (owonflag>128){
-    if (debug) printf("\nOwon 3rd-int flag>128: We're still not done yet!!\n");
-    goto readnextchannel;
-  }	
+void freeOwonFrame(struct owonFrame *fr){
+  free(fr->pixels);
+  free(fr->previous);
+  free(fr->dirty);
+  free(fr->readbuffer);
+  memset(fr, 0, sizeof(struct owonFrame));
+}
 
-  return;
+// release the channel buffers of a read, last-in first-out
+void freeOwonData(struct owonInfo *xinf){
+  int i;
+
+  if (debug) printf("Freeing memory:\n");
+  for (i=MAX_CHANNELS-1; i>=0; i--){  // also a block left by an aborted read
+    if (!xinf->channels[i].memoryaddress) continue;
+    if (debug) printf("--block %d, size %d bytes at %p.\n", i,
+          xinf->channels[i].memorysize, xinf->channels[i].memoryaddress);
+    free(xinf->channels[i].memoryaddress);
+    xinf->channels[i].memoryaddress = NULL;
+    xinf->channels[i].headeraddress = NULL;
+    xinf->channels[i].dataaddress = NULL;
+  }
+  xinf->nchannels = 0;
+  xinf->startaddress = NULL;
 }
 
 void initializeOwonLib(){
@@ -645,5 +1133,7 @@ void initializeOwonLib(){
   if (debug) { printf("<<<< Welcome to owonlib debug information >>>>\n");
        printf("Initialising libUSB\n");}
   for (i=0; i<10; i++) oinfo.channels[i].memoryaddress = NULL;
+  oinfo.model = &owonUnknownModel;
+  buildModelHash();
     usb_init();
 }
\ No newline at end of file
@@ -11,12 +11,19 @@
 #include <string.h>
 #include <time.h>
 
+#ifndef debug
 #define debug 1
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 #define USB_LOCK_VENDOR 0x5345        // (5345) Owon Technologies
 #define USB_LOCK_PRODUCT 0x1234       // (1234) PDS Digital Oscilloscope
 #define RESPONSE_START_LENGTH 12      // minimum reply 'header'
 #define OWON_START_DATA_CMD "STARTBIN"
+#define OWON_START_BMP_CMD "STARTBMP"
 #define BULK_WRITE_ENDPOINT 0x03
 #define BULK_READ_ENDPOINT 0x81
 #define DEFAULT_INTERFACE 0x00
@@ -25,12 +32,10 @@
 #define DEFAULT_BITMAP_READ_TIMEOUT 3000 // ms USB timeout for BMP
 #define MAX_OWON_DEVICES 10           // max number of scopes connected
 #define VECTORGRAM_BLOCK_HEADER_CHNAMELEN 3	// "CH1", "CH2", "CHA", etc.
+#define VECTORGRAM_CHANNEL_HEADER_LENGTH 59	// channel name + 14 ints
 #define MAX_CHANNELS 10               // every scope can have up to 10 channels
-
-struct usb_device *owon_devices[MAX_OWON_DEVICES];
-// usb_dev_handle *devhandle;
-
-int vgramheaderlength;
+#define MAX_SCREEN_SIZE 4096          // max width and height of a screenshot
+#define OWON_TILE_SIZE 16             // screenshot delta is done per 16x16 pixels
 
 // header of every channel of data:
 struct channelInfo {	
@@ -59,6 +64,23 @@ struct channelInfo {
   int memorysize;
 };
 
+// table of scale values (time/div or volt/div) indexed by header level:
+struct owonScaleTable {
+  int firstlevel;      // level of value[0]
+  int nlevels;
+  const double *value;
+};
+
+// one row of the scope model registry:
+struct owonModel {
+  char id[7];          // file description, e.g. "SPBS02"
+  char name[9];        // model of oscilloscope
+  int nameoffset;      // device name in the file header (at most 8 bytes),
+  int namelength;      //  length 0: not in the header, name is used
+  struct owonScaleTable timebase;   // in seconds
+  struct owonScaleTable vertscale;  // in volts
+};
+
 // set of Owon data:
 struct owonInfo {
   char *startaddress;  // header address
@@ -67,24 +89,87 @@ struct owonInfo {
   int memorysize;
   int nchannels;
   char timestring[21];
+  const struct owonModel *model;
   struct channelInfo channels[MAX_CHANNELS];
 };
 
+// screenshot of the scope:
+struct owonFrame {
+  int width;
+  int height;
+  unsigned int *pixels;   // 0x00RRGGBB, top row first
+  unsigned int *previous; // frame as last written to the screenshot stream
+  int nframes;            // frames written to the stream
+  int tilesx, tilesy;     // number of tiles across and down
+  unsigned char *dirty;   // per tile: changed since previous frame
+  int ndirty;             // number of dirty tiles
+  char *readbuffer;       // USB read buffer, reused for every screenshot
+  int readbuffersize;
+};
+
+// everything of one scope; see owonSessionOpen():
+struct owonSession {
+  usb_dev_handle *devhandle;
+  int vgramheaderlength;
+  struct owonInfo info;
+  struct owonFrame *frame;  // a 'BM' reply is decoded into this, NULL: not decoded
+  char *rawfilename;        // with debug, every block read is written here; NULL: not
+};
+
+#define OWON_CMD_NOT_SENT (-100000) // batch stopped at an earlier failed command
+
+// one command of a batch, see owonCommandBatch():
+struct owonCommandItem {
+  char *cmd;           // command string
+  char *reply;         // buffer for the reply, NULL if none expected
+  int replysize;       // size of reply buffer
+  int written;         // bytes written, <0 USB error, or OWON_CMD_NOT_SENT
+  int read;            // bytes of reply read, <0 USB error
+  double latency;      // s from start of batch until this command completed
+};
+
 // externally visible variables:
 extern char *owonfilename;
 extern char *owondefaultfilename;
 extern struct owonInfo oinfo;
+extern struct owonFrame oframe;
 extern usb_dev_handle *devhandle;
 extern int numowondevices;
+extern struct usb_device *owon_devices[MAX_OWON_DEVICES];
+extern int vgramheaderlength;
 
 // externally visible functions:
-extern void printFileInfo(struct owonInfo xinf);
-extern void printChannelInfo(struct channelInfo chinfo);
+extern void printFileInfo(const struct owonInfo *xinf);
+extern void printChannelInfo(const struct channelInfo *chinfo);
 extern int findOwons();
 extern void saveDataASCII(char *fname);
 extern void saveDataMatlab(char *fname);
 extern int owonCommand(char *cmd);
+extern int owonCommandBatch(struct owonCommandItem *items, int n);
+extern int owonSessionCommandBatch(struct owonSession *s, struct owonCommandItem *items, int n);
 extern int openCommunication(struct usb_device *dev);
 extern int closeCommunication();
 extern void owonReadMemory(struct usb_device *dev);
-extern void initializeOwonLib();
\ No newline at end of file
+extern int decodeOwonBuffer(char *owondatabuffer, unsigned int owondatabuffersize);
+extern void owonSessionInit(struct owonSession *s);
+extern int owonSessionOpen(struct owonSession *s, struct usb_device *dev);
+extern int owonSessionClose(struct owonSession *s);
+extern int owonSessionCommand(struct owonSession *s, char *cmd);
+extern void owonSessionRead(struct owonSession *s);
+extern int owonSessionDecode(struct owonSession *s, char *owondatabuffer, unsigned int owondatabuffersize);
+extern void initializeOwonLib();
+extern const struct owonModel *findOwonModel(const char *id);
+extern int owonSampleCount(const struct channelInfo *chinfo);
+extern double owonSampleTime(const struct channelInfo *chinfo, int j);
+extern double owonSampleVolt(const struct channelInfo *chinfo, int j);
+extern void freeOwonData(struct owonInfo *xinf);
+extern int decodeBitmap(char *xbuffer, int sizebuf, struct owonFrame *fr);
+extern int owonFrameDelta(struct owonFrame *fr);
+extern int saveScreenshotStream(FILE *fp, struct owonFrame *fr);
+extern int owonReadScreenshot(struct owonFrame *fr);
+extern int owonSessionReadScreenshot(struct owonSession *s, struct owonFrame *fr);
+extern void freeOwonFrame(struct owonFrame *fr);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,135 @@
+/**************************************************************\
+ * PSOwon. C++ layer on top of the owonlib C core             *
+ *    Peter Stallinga, 2020.                                  *
+ *                                                            *
+ * Needs C++20 (std::span). Link with owonlib.c and -lusb.    *
+\**************************************************************/
+
+#ifndef OWONLIB_HPP
+#define OWONLIB_HPP
+
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <utility>
+#include "owonlib.h"
+
+namespace owon {
+
+// lazy range of calculated values (time or voltage) of one channel;
+// every value is computed when it is read, no array is ever made.
+template <double (*F)(const struct channelInfo *, int)>
+class ValueRange {
+ public:
+  class iterator {
+   public:
+    iterator(const struct channelInfo *ch, int j) : ch_(ch), j_(j) {}
+    double operator*() const { return F(ch_, j_); }
+    iterator &operator++() { ++j_; return *this; }
+    bool operator!=(const iterator &o) const { return j_ != o.j_; }
+   private:
+    const struct channelInfo *ch_;
+    int j_;
+  };
+
+  explicit ValueRange(const struct channelInfo *ch) : ch_(ch) {}
+  int size() const { return owonSampleCount(ch_); }
+  double operator[](int j) const { return F(ch_, j); }
+  iterator begin() const { return iterator(ch_, 0); }
+  iterator end() const { return iterator(ch_, size()); }
+
+ private:
+  const struct channelInfo *ch_;
+};
+
+using TimeRange = ValueRange<owonSampleTime>;
+using VoltRange = ValueRange<owonSampleVolt>;
+
+// One read of a scope. Owns the channel buffers; can be moved, not copied.
+class Capture {
+ public:
+  Capture() : info_() {}
+  ~Capture() { freeOwonData(&info_); }
+  Capture(const Capture &) = delete;
+  Capture &operator=(const Capture &) = delete;
+  Capture(Capture &&o) noexcept : info_(o.info_) { o.clear(); }
+  Capture &operator=(Capture &&o) noexcept {
+    if (this != &o) {
+      freeOwonData(&info_);
+      info_ = o.info_;
+      o.clear();
+    }
+    return *this;
+  }
+
+  // take over the buffers of a read from xinf (e.g. the info of a session)
+  static Capture take(struct owonInfo &xinf) {
+    Capture c;
+    c.info_ = xinf;
+    for (int i = 0; i < MAX_CHANNELS; i++) xinf.channels[i].memoryaddress = NULL;
+    xinf.nchannels = 0;
+    xinf.startaddress = NULL;
+    return c;
+  }
+
+  const struct owonInfo &info() const { return info_; }
+  int nchannels() const { return info_.nchannels; }
+  const struct channelInfo &channel(int i) const { return info_.channels[i]; }
+
+  // raw samples of channel i, without copying
+  std::span<const int16_t> samples(int i) const {
+    return std::span<const int16_t>(
+        reinterpret_cast<const int16_t *>(info_.channels[i].dataaddress),
+        owonSampleCount(&info_.channels[i]));
+  }
+  TimeRange times(int i) const { return TimeRange(&info_.channels[i]); }
+  VoltRange volts(int i) const { return VoltRange(&info_.channels[i]); }
+
+ private:
+  void clear() {
+    for (int i = 0; i < MAX_CHANNELS; i++) info_.channels[i].memoryaddress = NULL;
+    info_.nchannels = 0;
+    info_.startaddress = NULL;
+  }
+
+  struct owonInfo info_;
+};
+
+// Communication with one scope for the lifetime of the object. Every Session
+// has its own struct owonSession, so several scopes can be used at once.
+class Session {
+ public:
+  explicit Session(struct usb_device *dev) {
+    owonSessionInit(&s_);
+    if (owonSessionOpen(&s_, dev))
+      throw std::runtime_error("owon: failed to open communication");
+  }
+  ~Session() {
+    freeOwonData(&s_.info);
+    owonSessionClose(&s_);
+  }
+  Session(const Session &) = delete;
+  Session &operator=(const Session &) = delete;
+
+  int command(const char *cmd) { return owonSessionCommand(&s_, const_cast<char *>(cmd)); }
+  int commandBatch(struct owonCommandItem *items, int n) {
+    return owonSessionCommandBatch(&s_, items, n);
+  }
+  int readScreenshot(struct owonFrame *fr) { return owonSessionReadScreenshot(&s_, fr); }
+
+  Capture read() {
+    owonSessionRead(&s_);
+    if (s_.info.nchannels == 0) {
+      freeOwonData(&s_.info);
+      throw std::runtime_error("owon: failed to read scope memory");
+    }
+    return Capture::take(s_.info);
+  }
+
+ private:
+  struct owonSession s_;
+};
+
+}  // namespace owon
+
+#endif
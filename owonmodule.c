@@ -0,0 +1,249 @@
+/**************************************************************\
+ * PSOwon. Python binding of owonlib                          *
+ *    Peter Stallinga, 2020.                                  *
+ *                                                            *
+ * The samples of every channel are exported with the buffer  *
+ * protocol, so numpy.asarray(channel) does not copy them.    *
+\**************************************************************/
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <structmember.h>
+#include <pythread.h>
+#include <stddef.h>
+#include "owonlib.h"
+
+// one lock per scope: different scopes are read at the same time, each with
+// its own owonSession. find() takes all of them, as it renews owon_devices.
+static PyThread_type_lock devicelock[MAX_OWON_DEVICES];
+
+// one read of a scope, owns the channel buffers:
+typedef struct {
+  PyObject_HEAD
+  struct owonInfo info;
+} CaptureObject;
+
+// one channel of a capture, keeps its capture alive:
+typedef struct {
+  PyObject_HEAD
+  CaptureObject *capture;
+  struct channelInfo chinfo;  // copy of the header (not of the data)
+  Py_ssize_t nsamples;        // shape of the exported buffer
+} ChannelObject;
+
+static PyTypeObject CaptureType;
+static PyTypeObject ChannelType;
+
+/*------------------------------- Channel ------------------------------*/
+
+static void Channel_dealloc(ChannelObject *self){
+  Py_XDECREF(self->capture);
+  Py_TYPE(self)->tp_free((PyObject *) self);
+}
+
+static int Channel_getbuffer(ChannelObject *self, Py_buffer *view, int flags){
+  if ((flags & PyBUF_WRITABLE)==PyBUF_WRITABLE) {
+    PyErr_SetString(PyExc_BufferError, "Owon channel data is read-only");
+    view->obj = NULL;
+    return(-1);
+  }
+  view->buf = self->chinfo.dataaddress;
+  view->obj = (PyObject *) self;
+  Py_INCREF(self);
+  view->len = self->nsamples*sizeof(short int);
+  view->readonly = 1;
+  view->itemsize = sizeof(short int);
+  view->format = (flags & PyBUF_FORMAT) ? "h" : NULL;
+  view->ndim = 1;
+  view->shape = (flags & PyBUF_ND) ? &self->nsamples : NULL;
+  view->strides = ((flags & PyBUF_STRIDES)==PyBUF_STRIDES) ? &view->itemsize : NULL;
+  view->suboffsets = NULL;
+  view->internal = NULL;
+  return(0);
+}
+
+static PyBufferProcs Channel_as_buffer = {
+  (getbufferproc) Channel_getbuffer,
+  NULL
+};
+
+static Py_ssize_t Channel_length(ChannelObject *self){
+  return(self->nsamples);
+}
+
+static PySequenceMethods Channel_as_sequence = {
+  (lenfunc) Channel_length,
+};
+
+#define CHMEMBER(name, type) \
+  { #name, type, offsetof(ChannelObject, chinfo)+offsetof(struct channelInfo, name), READONLY, NULL }
+
+static PyMemberDef Channel_members[] = {
+  CHMEMBER(channelname, T_STRING_INPLACE),
+  CHMEMBER(blocklength, T_INT),
+  CHMEMBER(extendedflag, T_INT),
+  CHMEMBER(offset, T_INT),
+  CHMEMBER(wholescreencollectingpoints, T_INT),
+  CHMEMBER(numberofcollectingpoints, T_INT),
+  CHMEMBER(slowmovingnumber, T_INT),
+  CHMEMBER(timebaselevel, T_INT),
+  CHMEMBER(zeropoint, T_INT),
+  CHMEMBER(voltagelevel, T_INT),
+  CHMEMBER(attenmultpowrindex, T_INT),
+  CHMEMBER(spacinginterval, T_INT),
+  CHMEMBER(frequency, T_INT),
+  CHMEMBER(cycle, T_INT),
+  CHMEMBER(voltvalueperpoint, T_INT),
+  CHMEMBER(vertScale, T_DOUBLE),
+  CHMEMBER(timeBase, T_DOUBLE),
+  CHMEMBER(extradatavalid, T_INT),
+  { NULL }
+};
+
+static PyTypeObject ChannelType = {
+  PyVarObject_HEAD_INIT(NULL, 0)
+  .tp_name = "owon.Channel",
+  .tp_doc = "Channel of a capture. Exports its int16 samples with the buffer protocol.",
+  .tp_basicsize = sizeof(ChannelObject),
+  .tp_flags = Py_TPFLAGS_DEFAULT,
+  .tp_dealloc = (destructor) Channel_dealloc,
+  .tp_as_buffer = &Channel_as_buffer,
+  .tp_as_sequence = &Channel_as_sequence,
+  .tp_members = Channel_members,
+};
+
+/*------------------------------- Capture ------------------------------*/
+
+static void Capture_dealloc(CaptureObject *self){
+  freeOwonData(&self->info);
+  Py_TYPE(self)->tp_free((PyObject *) self);
+}
+
+static Py_ssize_t Capture_length(CaptureObject *self){
+  return(self->info.nchannels);
+}
+
+static PyObject *Capture_item(CaptureObject *self, Py_ssize_t i){
+  ChannelObject *ch;
+
+  if (i<0 || i>=self->info.nchannels) {
+    PyErr_SetString(PyExc_IndexError, "channel index out of range");
+    return(NULL);
+  }
+  ch = PyObject_New(ChannelObject, &ChannelType);
+  if (!ch) return(NULL);
+  Py_INCREF(self);
+  ch->capture = self;
+  ch->chinfo = self->info.channels[i];
+  ch->nsamples = owonSampleCount(&ch->chinfo);  // never past the end of the block
+  return((PyObject *) ch);
+}
+
+static PySequenceMethods Capture_as_sequence = {
+  (lenfunc) Capture_length,
+  NULL, NULL,
+  (ssizeargfunc) Capture_item,
+};
+
+static PyMemberDef Capture_members[] = {
+  { "idn", T_STRING_INPLACE, offsetof(CaptureObject, info.idn), READONLY, NULL },
+  { "devicename", T_STRING_INPLACE, offsetof(CaptureObject, info.devicename), READONLY, NULL },
+  { "timestring", T_STRING_INPLACE, offsetof(CaptureObject, info.timestring), READONLY, NULL },
+  { "memorysize", T_INT, offsetof(CaptureObject, info.memorysize), READONLY, NULL },
+  { "nchannels", T_INT, offsetof(CaptureObject, info.nchannels), READONLY, NULL },
+  { NULL }
+};
+
+static PyTypeObject CaptureType = {
+  PyVarObject_HEAD_INIT(NULL, 0)
+  .tp_name = "owon.Capture",
+  .tp_doc = "One read of an Owon scope; a sequence of channels.",
+  .tp_basicsize = sizeof(CaptureObject),
+  .tp_flags = Py_TPFLAGS_DEFAULT,
+  .tp_dealloc = (destructor) Capture_dealloc,
+  .tp_as_sequence = &Capture_as_sequence,
+  .tp_members = Capture_members,
+};
+
+/*------------------------------- module -------------------------------*/
+
+static PyObject *owon_find(PyObject *self, PyObject *args){
+  int i, n;
+
+  Py_BEGIN_ALLOW_THREADS
+  for (i=0; i<MAX_OWON_DEVICES; i++) PyThread_acquire_lock(devicelock[i], WAIT_LOCK);
+  numowondevices = 0;
+  n = findOwons();
+  for (i=MAX_OWON_DEVICES-1; i>=0; i--) PyThread_release_lock(devicelock[i]);
+  Py_END_ALLOW_THREADS
+  return(PyLong_FromLong(n));
+}
+
+static PyObject *owon_read(PyObject *self, PyObject *args){
+  int iowon, ret=0, nodevice=0;
+  CaptureObject *cap;
+  struct owonSession s;
+
+  if (!PyArg_ParseTuple(args, "i", &iowon)) return(NULL);
+  if (iowon<0 || iowon>=MAX_OWON_DEVICES) {
+    PyErr_SetString(PyExc_IndexError, "no such Owon device, call find() first");
+    return(NULL);
+  }
+  cap = PyObject_New(CaptureObject, &CaptureType);
+  if (!cap) return(NULL);
+  memset(&cap->info, 0, sizeof(struct owonInfo));
+  owonSessionInit(&s);
+
+  Py_BEGIN_ALLOW_THREADS
+  PyThread_acquire_lock(devicelock[iowon], WAIT_LOCK);
+  if (iowon>=numowondevices) nodevice = 1;
+  else {
+    ret = owonSessionOpen(&s, owon_devices[iowon]);
+    if (!ret) {
+      owonSessionRead(&s);
+      owonSessionClose(&s);
+    }
+  }
+  PyThread_release_lock(devicelock[iowon]);
+  Py_END_ALLOW_THREADS
+
+  cap->info = s.info;  // the capture owns the buffers now
+  if (nodevice || ret || cap->info.nchannels==0) {
+    Py_DECREF(cap);
+    if (nodevice)
+      PyErr_SetString(PyExc_IndexError, "no such Owon device, call find() first");
+    else
+      PyErr_SetString(PyExc_IOError, "failed to read Owon memory");
+    return(NULL);
+  }
+  return((PyObject *) cap);
+}
+
+static PyMethodDef owon_methods[] = {
+  { "find", owon_find, METH_NOARGS, "Search the USB buses; returns the number of Owons found." },
+  { "read", owon_read, METH_VARARGS, "read(i): read the memory of Owon i; returns a Capture." },
+  { NULL, NULL, 0, NULL }
+};
+
+static struct PyModuleDef owon_module = {
+  PyModuleDef_HEAD_INIT, "owon", "Owon oscilloscopes over USB.", -1, owon_methods
+};
+
+PyMODINIT_FUNC PyInit_owon(void){
+  PyObject *m;
+  int i;
+
+  if (PyType_Ready(&CaptureType)<0 || PyType_Ready(&ChannelType)<0) return(NULL);
+  for (i=0; i<MAX_OWON_DEVICES; i++) {
+    devicelock[i] = PyThread_allocate_lock();
+    if (!devicelock[i]) return(PyErr_NoMemory());
+  }
+  m = PyModule_Create(&owon_module);
+  if (!m) return(NULL);
+  Py_INCREF(&CaptureType);
+  PyModule_AddObject(m, "Capture", (PyObject *) &CaptureType);
+  Py_INCREF(&ChannelType);
+  PyModule_AddObject(m, "Channel", (PyObject *) &ChannelType);
+  initializeOwonLib();
+  return(m);
+}